@@ -0,0 +1,235 @@
+#include <benchmark/benchmark.h>
+#include "router.hpp"
+#include "sim.hpp"
+#include "history.hpp"
+#include "scheduler.hpp"
+#include "session_pool.hpp"
+#include "recv_buffer.hpp"
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// 路由核心的微基准，不经过socket，每次改动热路径之后跑一遍看ns/消息有没有变化
+// 编译：g++ -O2 -std=c++17 bench.cpp -o bench -lbenchmark -lpthread
+
+// 登录n个用户，用户i的名字是字符i
+static std::vector<chat::session_id> login_all(chat::router& router,chat::fake_clock& clock,int n){
+  std::vector<chat::session_id> ids;
+  std::string line;
+  for(int i=0;i<n;i++){
+    chat::session_id id=router.open_session(clock.now());
+    line.assign("L");
+    line.push_back(static_cast<char>(i));
+    router.on_line(id,line,clock.now(),[](chat::session_id){});
+    ids.push_back(id);
+  }
+  return ids;
+}
+
+// 按客户名查会话
+static void BM_lookup(benchmark::State& state){
+  chat::router router;
+  chat::fake_clock clock;
+  int n=static_cast<int>(state.range(0));
+  login_all(router,clock,n);
+  int i=0;
+  for(auto _:state){
+    benchmark::DoNotOptimize(router.lookup(static_cast<char>(i)));
+    if(++i==n) i=0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_lookup)->Arg(2)->Arg(256);
+
+// 一条私聊消息：解析、查表、追加到目标的发送缓冲，再由传输层取走
+static void BM_enqueue(benchmark::State& state){
+  chat::router router;
+  chat::fake_clock clock;
+  std::vector<chat::session_id> ids=login_all(router,clock,2);
+  std::string line="S"+std::string(1,'\1')+std::string(state.range(0),'x');
+  std::string scratch;
+  for(auto _:state){
+    router.on_line(ids[0],line,clock.now(),[&](chat::session_id to){
+      router.take_output(to,scratch);
+    });
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*(line.size()+1));
+}
+BENCHMARK(BM_enqueue)->Arg(16)->Arg(256);
+
+// 房间广播：一条消息扇出给房间里的其他成员
+static void BM_fanout(benchmark::State& state){
+  chat::router router;
+  chat::fake_clock clock;
+  int members=static_cast<int>(state.range(0));
+  std::vector<chat::session_id> ids=login_all(router,clock,members);
+  for(chat::session_id id:ids) router.on_line(id,"Jr",clock.now(),[](chat::session_id){});
+  std::string line="Rrhello room";
+  std::string scratch;
+  for(auto _:state){
+    router.on_line(ids[0],line,clock.now(),[&](chat::session_id to){
+      router.take_output(to,scratch);
+    });
+  }
+  state.SetItemsProcessed(state.iterations()*(members-1));
+}
+BENCHMARK(BM_fanout)->Arg(2)->Arg(16)->Arg(256);
+
+// 混合负载：登录、私聊、广播、断开重连
+static void BM_simulation(benchmark::State& state){
+  chat::simulation sim(static_cast<std::size_t>(state.range(0)),8);
+  for(auto _:state){
+    sim.run(1000);
+  }
+  state.SetItemsProcessed(state.iterations()*1000);
+  state.counters["logins"]=static_cast<double>(sim.stats().logins);
+  state.counters["disconnects"]=static_cast<double>(sim.stats().disconnects);
+}
+BENCHMARK(BM_simulation)->Arg(16)->Arg(256);
+
+// 限速检查本身的开销：用户桶、IP桶、房间桶各补充一次并扣一个令牌
+static void BM_admit(benchmark::State& state){
+  chat::rate_limiter limiter(chat::rate_config{});
+  chat::fake_clock clock;
+  for(chat::session_id id=0;id<256;id++) limiter.open(id,id/8);
+  chat::session_id id=0;
+  for(auto _:state){
+    clock.advance(std::chrono::milliseconds(1));
+    benchmark::DoNotOptimize(limiter.admit(id,static_cast<int>(id&7),clock.now()));
+    id=(id+1)&255;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_admit);
+
+// 开启默认限速的混合负载，假时钟每个操作前进1微秒，所以大部分消息会被限速
+static void BM_simulation_limited(benchmark::State& state){
+  chat::simulation sim(static_cast<std::size_t>(state.range(0)),8,1,chat::rate_config{});
+  for(auto _:state){
+    sim.run(1000);
+  }
+  state.SetItemsProcessed(state.iterations()*1000);
+  state.counters["throttled"]=static_cast<double>(sim.stats().throttled);
+}
+BENCHMARK(BM_simulation_limited)->Arg(256);
+
+// 差额轮询调度：1个不停发送的重度用户加上state.range(0)个每轮只发一条消息的轻度用户。
+// light_per_round应该等于轻度用户数，说明重度用户没有挤占他们
+static void BM_drr_round(benchmark::State& state){
+  chat::drr_scheduler scheduler(4096);
+  chat::fake_clock clock;
+  int light=static_cast<int>(state.range(0));
+  std::vector<int> pending(light+1,0);
+  std::uint64_t messages=0,light_messages=0,rounds=0;
+  for(auto _:state){
+    // 每轮开始时轻度用户各来一条消息，重度用户始终积压着消息
+    pending[0]=1<<30;
+    scheduler.mark_ready(0);
+    for(int i=1;i<=light;i++){
+      pending[i]=1;
+      scheduler.mark_ready(i);
+    }
+    scheduler.run_round([&]{ return clock.now(); },
+      [&](chat::session_id id)->std::size_t{
+        return pending[id]>0?64:0;
+      },
+      [&](chat::session_id id){
+        --pending[id];
+        ++messages;
+        if(id!=0) ++light_messages;
+        clock.advance(std::chrono::nanoseconds(100));
+        return true;
+      });
+    ++rounds;
+  }
+  state.SetItemsProcessed(messages);
+  state.counters["light_per_round"]=static_cast<double>(light_messages)/rounds;
+  state.counters["heavy_max_slice_ns"]=static_cast<double>(std::chrono::nanoseconds(scheduler.stats(0).max_slice).count());
+}
+BENCHMARK(BM_drr_round)->Arg(16)->Arg(256);
+
+// 会话池：凭句柄取对象（含代数检查），以及断开重连时的销毁和创建
+struct fake_session{
+  chat::recv_buffer buffer;
+  std::uint64_t bytes=0;
+};
+
+static void BM_pool_get(benchmark::State& state){
+  chat::session_pool<fake_session> pool;
+  std::vector<chat::pool_handle> handles;
+  for(int64_t i=0;i<state.range(0);i++) handles.push_back(pool.create());
+  std::size_t i=0;
+  for(auto _:state){
+    fake_session* s=pool.get(handles[i]);
+    s->bytes++;
+    if(++i==handles.size()) i=0;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["slot_bytes"]=static_cast<double>(decltype(pool)::slot_bytes());
+}
+BENCHMARK(BM_pool_get)->Arg(1024)->Arg(1<<20);
+
+static void BM_pool_churn(benchmark::State& state){
+  chat::session_pool<fake_session> pool;
+  std::vector<chat::pool_handle> handles;
+  for(int i=0;i<1024;i++) handles.push_back(pool.create());
+  std::size_t i=0;
+  for(auto _:state){
+    pool.destroy(handles[i]);
+    handles[i]=pool.create();
+    i=(i+1)&1023;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_pool_churn);
+
+// 造一条由n个随机词组成的消息，词表大小为vocab，词频近似齐普夫分布
+static std::string random_line(std::mt19937_64& rng,int n,int vocab){
+  std::string line="Rr";
+  for(int i=0;i<n;i++){
+    double u=std::uniform_real_distribution<double>(0,1)(rng);
+    int w=static_cast<int>(std::pow(static_cast<double>(vocab),u))-1;
+    line+=" w"+std::to_string(w);
+  }
+  return line;
+}
+
+// 建索引：每条消息8个词
+static void BM_index_add(benchmark::State& state){
+  chat::history_index index(chat::history_config{static_cast<std::size_t>(state.range(0)),std::size_t(1)<<34});
+  std::mt19937_64 rng(1);
+  std::vector<std::string> lines;
+  for(int i=0;i<4096;i++) lines.push_back(random_line(rng,8,100000));
+  std::size_t i=0;
+  for(auto _:state){
+    index.add(chat::room_conversation('r'),lines[i++&4095]);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["bytes_per_msg"]=static_cast<double>(index.memory_bytes())/index.size();
+}
+BENCHMARK(BM_index_add)->Arg(100000)->Arg(1000000);
+
+// 在state.range(0)条历史消息中做两个词的与查询
+static void BM_search(benchmark::State& state){
+  chat::history_index index(chat::history_config{static_cast<std::size_t>(state.range(0)),std::size_t(1)<<34});
+  std::mt19937_64 rng(1);
+  for(int64_t i=0;i<state.range(0);i++) index.add(chat::room_conversation('r'),random_line(rng,8,100000));
+  chat::viewer who;
+  who.rooms.push_back('r');
+  std::vector<std::string> queries;
+  for(int i=0;i<64;i++){
+    std::string q=random_line(rng,2,1000);
+    queries.push_back(q.substr(2));
+  }
+  std::size_t i=0,hits=0;
+  for(auto _:state){
+    hits+=index.search(queries[i++&63],who,20).size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hits_per_query"]=static_cast<double>(hits)/state.iterations();
+}
+BENCHMARK(BM_search)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,540 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "types.hpp"
+
+// 聊天记录的全文检索：按私聊/房间保存最近的消息，并增量地维护一个倒排索引。
+// history_index本身是单线程的数据结构，history_service在它外面包了一个后台线程，
+// server只把“记录”和“搜索”两种任务丢进队列，转发线程(io_context)不会被建索引拖慢
+namespace chat{
+
+// 会话标识：私聊由双方客户名组成（小的在前，所以a发给b和b发给a属于同一个会话），房间由房间名组成
+inline std::uint32_t direct_conversation(char x,char y){
+  unsigned char a=static_cast<unsigned char>(x),b=static_cast<unsigned char>(y);
+  if(a>b) std::swap(a,b);
+  return ('S'<<16)|(a<<8)|b;
+}
+
+inline std::uint32_t room_conversation(char room){
+  return ('R'<<16)|static_cast<unsigned char>(room);
+}
+
+// 发起搜索的人能看到哪些会话：自己参与的私聊，以及当前所在的房间
+struct viewer{
+  bool named=false;
+  char name=0;
+  std::vector<unsigned char> rooms;
+};
+
+// 压缩的倒排链：文档编号严格递增，按block_size个一块存放。每块的第一个编号和最后一个编号单独记在块信息里，
+// 块内其余编号只保存和前一个的差值，用变长整数(varint)编码，最近的消息编号之间的差值通常只要1个字节。
+// 块信息里的first/last就是跳跃指针：从新往旧查找时，整块都比目标新的块不用解码
+class posting_list{
+public:
+  static constexpr std::size_t block_size=128;
+
+  struct block{
+    std::uint64_t first;   // 块内最早的编号
+    std::uint64_t last;    // 块内最新的编号
+    std::uint32_t offset;  // 块内差值在bytes_中的起点
+    std::uint32_t count;
+  };
+
+  void add(std::uint64_t doc){
+    if(blocks_.empty()||blocks_.back().count==block_size){
+      blocks_.push_back(block{doc,doc,static_cast<std::uint32_t>(bytes_.size()),1});
+    }
+    else{
+      put(doc-blocks_.back().last);
+      blocks_.back().last=doc;
+      ++blocks_.back().count;
+    }
+    ++count_;
+  }
+
+  // 把第i块按从旧到新的顺序解码到out中，返回个数
+  std::size_t decode_block(std::size_t i,std::uint64_t* out) const{
+    const block& b=blocks_[head_+i];
+    std::uint64_t doc=b.first;
+    std::size_t pos=b.offset;
+    out[0]=doc;
+    for(std::uint32_t k=1;k<b.count;k++){
+      std::uint64_t delta=0;
+      int shift=0;
+      unsigned char c;
+      do{
+        c=static_cast<unsigned char>(bytes_[pos++]);
+        delta|=static_cast<std::uint64_t>(c&0x7f)<<shift;
+        shift+=7;
+      }while(c&0x80);
+      doc+=delta;
+      out[k]=doc;
+    }
+    return b.count;
+  }
+
+  // 丢掉整块都早于oldest的块（其中的消息已经因为超出保留上限被淘汰了），不需要解码。
+  // 只有一部分过期的块留着，搜索时会跳过其中过期的编号。
+  // 过期的块先只移动head_，不少于剩下的块时才真正挪动数据，均摊下来每块只挪一次
+  void drop_before(std::uint64_t oldest){
+    while(head_<blocks_.size()&&blocks_[head_].last<oldest){
+      count_-=blocks_[head_].count;
+      ++head_;
+    }
+    if(head_==blocks_.size()){
+      if(head_) *this=posting_list();
+      return;
+    }
+    if(head_==0||head_<blocks_.size()-head_) return;
+    std::uint32_t base=blocks_[head_].offset;
+    bytes_.erase(0,base);
+    blocks_.erase(blocks_.begin(),blocks_.begin()+head_);
+    head_=0;
+    for(block& b:blocks_) b.offset-=base;
+    // 链还在增长时腾出来的容量很快会被新的编号用上，只有链明显变短了才把多余的容量还回去
+    if(bytes_.capacity()>4*bytes_.size()) bytes_.shrink_to_fit();
+    if(blocks_.capacity()>4*blocks_.size()) blocks_.shrink_to_fit();
+  }
+
+  const block& meta(std::size_t i) const{
+    return blocks_[head_+i];
+  }
+  std::size_t block_count() const{
+    return blocks_.size()-head_;
+  }
+  std::uint64_t last() const{
+    return blocks_.back().last;
+  }
+  std::size_t count() const{
+    return count_;
+  }
+  bool empty() const{
+    return count_==0;
+  }
+
+  // 在堆上占用的字节数，对象本身的大小由持有它的哈希表节点计入
+  std::size_t bytes() const{
+    std::size_t b=string_heap_bytes(bytes_);
+    if(blocks_.capacity()) b+=blocks_.capacity()*sizeof(block)+alloc_overhead;
+    return b;
+  }
+
+private:
+  void put(std::uint64_t v){
+    while(v>=0x80){
+      bytes_.push_back(static_cast<char>(v|0x80));
+      v>>=7;
+    }
+    bytes_.push_back(static_cast<char>(v));
+  }
+
+private:
+  std::string bytes_;
+  std::vector<block> blocks_;
+  std::size_t head_=0;   // 第一个未过期的块
+  std::size_t count_=0;
+};
+
+// 从新往旧遍历倒排链的游标，只解码真正需要的块
+class posting_cursor{
+public:
+  explicit posting_cursor(const posting_list& list)
+    :list_(&list),block_(list.block_count()){
+  }
+
+  // 移到不大于target的最大编号，没有了返回false
+  bool seek(std::uint64_t target){
+    for(;;){
+      if(loaded_){
+        while(pos_>=0&&docs_[pos_]>target) --pos_;
+        if(pos_>=0) return true;
+        loaded_=false;
+      }
+      // 最早的编号都比target新的块整块跳过
+      while(block_>0&&list_->meta(block_-1).first>target) --block_;
+      if(block_==0) return false;
+      --block_;
+      pos_=static_cast<long>(list_->decode_block(block_,docs_))-1;
+      loaded_=true;
+    }
+  }
+
+  std::uint64_t doc() const{
+    return docs_[pos_];
+  }
+
+private:
+  const posting_list* list_;
+  std::size_t block_;  // 当前已解码的块；还没有解码过时等于块数
+  long pos_=-1;
+  bool loaded_=false;
+  std::uint64_t docs_[posting_list::block_size];
+};
+
+// 保留上限，条数和字节数任意一个超出都会淘汰消息。
+// 每次从占用字节数最多的会话淘汰它最旧的一条，所以一个刷屏的房间只会挤掉自己的历史，不会清空其他私聊和房间的记录
+struct history_config{
+  std::size_t max_messages=1000000;
+  std::size_t max_bytes=std::size_t(256)<<20;
+};
+
+class history_index{
+public:
+  // 一次搜索最多使用的关键词个数，多余的忽略
+  static constexpr std::size_t max_query_terms=8;
+
+  explicit history_index(history_config config={})
+    :config_(config){
+  }
+
+  // 记录一条已经转发出去的消息，line是完整的一行（包括开头的命令字符和目标名）
+  void add(std::uint32_t conv,std::string_view line){
+    auto [it,inserted]=convs_.try_emplace(conv);
+    conversation_log& log=it->second;
+    if(!inserted){
+      by_size_.erase({log.bytes(),conv});
+      total_bytes_-=log.bytes();
+    }
+    log.add(next_seq_++,line);
+    total_bytes_+=log.bytes();
+    by_size_.insert({log.bytes(),conv});
+    ++total_messages_;
+    evict();
+  }
+
+  // 在who能看到的每个会话里从新往旧查找同时包含query中所有词的消息，每个会话找到limit条就停，
+  // 再按时间合并，返回最新的limit条。耗时取决于可见的会话数和limit，而不是保存了多少历史
+  std::vector<std::string> search(std::string_view query,const viewer& who,std::size_t limit) const{
+    std::vector<std::string> results;
+    std::vector<std::string> tokens;
+    tokenize(query,[&](std::string_view token){
+      if(tokens.size()<max_query_terms&&std::find(tokens.begin(),tokens.end(),token)==tokens.end()) tokens.emplace_back(token);
+    });
+    if(tokens.empty()||limit==0) return results;
+
+    std::vector<hit> hits;
+    auto visit=[&](std::uint32_t conv){
+      auto it=convs_.find(conv);
+      if(it!=convs_.end()) it->second.search(tokens,limit,hits);
+    };
+    for(unsigned char room:who.rooms) visit(room_conversation(static_cast<char>(room)));
+    if(who.named){
+      for(int x=0;x<256;x++) visit(direct_conversation(who.name,static_cast<char>(x)));
+    }
+    std::sort(hits.begin(),hits.end(),[](const hit& x,const hit& y){
+      return x.seq>y.seq;
+    });
+    for(std::size_t i=0;i<hits.size()&&i<limit;i++) results.push_back(*hits[i].text);
+    return results;
+  }
+
+  std::size_t size() const{
+    return total_messages_;
+  }
+
+  std::size_t conversation_count() const{
+    return convs_.size();
+  }
+
+  std::size_t term_count() const{
+    std::size_t n=0;
+    for(const auto& c:convs_) n+=c.second.terms.size();
+    return n;
+  }
+
+  // 消息、词典（哈希表节点和词本身）、倒排链和每个会话自身占用的字节数，保留上限max_bytes按它来算。
+  // 已被淘汰的消息留下的词和倒排链在被清理之前也计算在内
+  std::size_t memory_bytes() const{
+    return total_bytes_;
+  }
+
+  // 分词：连续的ASCII字母数字算一个词（统一转成小写），其余非ASCII字符（比如汉字）每个UTF-8字符算一个词
+  template<class F>
+  static void tokenize(std::string_view text,F&& f){
+    std::string token;
+    std::size_t i=0;
+    while(i<text.size()){
+      unsigned char c=static_cast<unsigned char>(text[i]);
+      if(c<0x80){
+        if(std::isalnum(c)){
+          token.push_back(static_cast<char>(std::tolower(c)));
+        }
+        else if(!token.empty()){
+          f(std::string_view(token));
+          token.clear();
+        }
+        i++;
+        continue;
+      }
+      if(!token.empty()){
+        f(std::string_view(token));
+        token.clear();
+      }
+      std::size_t len=c>=0xf0?4:c>=0xe0?3:c>=0xc0?2:1;
+      len=std::min(len,text.size()-i);
+      f(text.substr(i,len));
+      i+=len;
+    }
+    if(!token.empty()) f(std::string_view(token));
+  }
+
+private:
+  struct message{
+    std::uint64_t seq;  // 全局递增的序号，用来在会话之间按时间合并搜索结果
+    std::string text;
+  };
+
+  struct hit{
+    std::uint64_t seq;
+    const std::string* text;
+  };
+
+  static std::size_t message_bytes(const message& m){
+    return sizeof(message)+string_heap_bytes(m.text);
+  }
+
+  // 词典中每个词的固定开销：哈希表节点（键、倒排链对象、next指针和缓存的哈希值）及其分配开销、桶数组中的一项，以及词本身
+  static std::size_t term_bytes(const std::string& token){
+    return sizeof(std::pair<const std::string,posting_list>)+3*sizeof(void*)+alloc_overhead+std::max(token.size(),string_heap_bytes(token));
+  }
+
+  // 一个会话的历史：消息、文档编号和倒排索引都是会话内独立的
+  struct conversation_log{
+    std::deque<message> messages;
+    std::uint64_t first_id=0; // messages.front()的编号
+    std::unordered_map<std::string,posting_list> terms;
+    std::size_t text_bytes=0;
+    std::size_t posting_bytes=0;
+    std::size_t sweep_cursor=0; // sweep下一次从哪个桶开始
+
+    std::size_t bytes() const{
+      return conversation_bytes+text_bytes+posting_bytes;
+    }
+
+    void add(std::uint64_t seq,std::string_view line){
+      std::uint64_t id=first_id+messages.size();
+      messages.push_back(message{seq,std::string(line)});
+      text_bytes+=message_bytes(messages.back());
+      tokenize(line.substr(std::min<std::size_t>(2,line.size())),[&](std::string_view token){
+        auto [it,inserted]=terms.try_emplace(std::string(token));
+        posting_list& list=it->second;
+        if(inserted) posting_bytes+=term_bytes(it->first)+list.bytes();
+        posting_bytes-=list.bytes();
+        list.drop_before(first_id);
+        // 同一条消息里重复出现的词只记一次
+        if(list.empty()||list.last()!=id) list.add(id);
+        posting_bytes+=list.bytes();
+      });
+    }
+
+    void evict_oldest(){
+      text_bytes-=message_bytes(messages.front());
+      messages.pop_front();
+      ++first_id;
+      sweep(sweep_buckets);
+    }
+
+    // 被淘汰的编号留在倒排链里只会在搜索时被跳过。每淘汰一条消息，就按顺序检查词典里的n个桶，
+    // 丢掉其中倒排链整块过期的部分，链空了就删掉这个词。每次只做固定的一点工作，后台线程不会因为
+    // 一次性重建整个词典而停顿；桶数和词数相当，所以大约淘汰“词数/n”条消息就能把整个词典清理一遍
+    void sweep(std::size_t n){
+      std::size_t buckets=terms.bucket_count();
+      for(std::size_t i=0;i<n;i++){
+        std::size_t b=sweep_cursor++%buckets;
+        for(auto it=terms.begin(b);it!=terms.end(b);){
+          posting_list& list=it->second;
+          posting_bytes-=list.bytes();
+          list.drop_before(first_id);
+          if(!list.empty()){
+            posting_bytes+=list.bytes();
+            ++it;
+            continue;
+          }
+          const std::string& token=it->first;
+          ++it;
+          posting_bytes-=term_bytes(token);
+          terms.erase(terms.find(token));
+        }
+      }
+    }
+
+    // 从新往旧做跳跃式求交：以最短的倒排链为主，其余链的游标只会往更旧的方向移动
+    void search(const std::vector<std::string>& tokens,std::size_t limit,std::vector<hit>& out) const{
+      std::vector<const posting_list*> lists;
+      for(const std::string& token:tokens){
+        auto it=terms.find(token);
+        if(it==terms.end()) return;
+        lists.push_back(&it->second);
+      }
+      std::sort(lists.begin(),lists.end(),[](const posting_list* x,const posting_list* y){
+        return x->count()<y->count();
+      });
+      std::vector<posting_cursor> cursors;
+      cursors.reserve(lists.size());
+      for(const posting_list* list:lists) cursors.emplace_back(*list);
+
+      std::uint64_t target=UINT64_MAX;
+      std::size_t found=0;
+      while(found<limit&&cursors[0].seek(target)){
+        std::uint64_t doc=cursors[0].doc();
+        if(doc<first_id) return;
+        bool all=true;
+        for(std::size_t i=1;i<cursors.size();i++){
+          if(!cursors[i].seek(doc)) return;
+          if(cursors[i].doc()<doc){
+            target=cursors[i].doc();
+            all=false;
+            break;
+          }
+        }
+        if(!all) continue;
+        const message& m=messages[doc-first_id];
+        out.push_back(hit{m.seq,&m.text});
+        ++found;
+        if(doc==0) return;
+        target=doc-1;
+      }
+    }
+  };
+
+  // 每淘汰一条消息清理的词典桶数
+  static constexpr std::size_t sweep_buckets=16;
+
+  // 每个会话自身的固定开销：哈希表节点、by_size_中的节点，以及std::deque即使只有一条消息也要分配的512字节缓冲和索引表
+  static constexpr std::size_t conversation_bytes=sizeof(std::pair<const std::uint32_t,conversation_log>)+3*sizeof(void*)
+    +sizeof(std::pair<std::size_t,std::uint32_t>)+4*sizeof(void*)+512+8*sizeof(void*)+4*alloc_overhead;
+
+  void evict(){
+    while(!by_size_.empty()&&(total_messages_>config_.max_messages||total_bytes_>config_.max_bytes)){
+      std::uint32_t conv=std::prev(by_size_.end())->second;
+      conversation_log& log=convs_.find(conv)->second;
+      by_size_.erase(std::prev(by_size_.end()));
+      total_bytes_-=log.bytes();
+      log.evict_oldest();
+      --total_messages_;
+      if(log.messages.empty()){
+        convs_.erase(conv);
+        continue;
+      }
+      total_bytes_+=log.bytes();
+      by_size_.insert({log.bytes(),conv});
+    }
+  }
+
+private:
+  history_config config_;
+  std::unordered_map<std::uint32_t,conversation_log> convs_;
+  // 按占用字节数排序的会话，淘汰时从最大的开始
+  std::set<std::pair<std::size_t,std::uint32_t>> by_size_;
+  std::uint64_t next_seq_=0;
+  std::size_t total_messages_=0;
+  std::size_t total_bytes_=0;
+};
+
+// 在后台线程上维护history_index。record和search都只是把任务放进队列就返回，
+// 搜索结果在后台线程上通过回调交给调用方，调用方需要自己把它投递回io_context
+class history_service{
+public:
+  using search_callback=std::function<void(std::vector<std::string>)>;
+
+  explicit history_service(history_config config={})
+    :index_(config),worker_([this]{ run(); }){
+  }
+
+  ~history_service(){
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_=true;
+    }
+    cv_.notify_one();
+    worker_.join();
+  }
+
+  // 队列里积压的任务上限。后台线程跟不上时，新的记录直接丢弃（消息本身已经转发出去了，只是搜不到），
+  // 新的搜索返回false，由调用方告诉用户稍后再试
+  static constexpr std::size_t max_pending_records=100000;
+  static constexpr std::size_t max_pending_searches=64;
+
+  void record(std::uint32_t conv,std::string line){
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if(pending_records_>=max_pending_records){
+        ++dropped_records_;
+        return;
+      }
+      ++pending_records_;
+      queue_.push_back(task{conv,std::move(line),{},0,nullptr});
+    }
+    cv_.notify_one();
+  }
+
+  bool search(std::string query,viewer who,std::size_t limit,search_callback done){
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if(pending_searches_>=max_pending_searches) return false;
+      ++pending_searches_;
+      queue_.push_back(task{0,std::move(query),std::move(who),limit,std::move(done)});
+    }
+    cv_.notify_one();
+    return true;
+  }
+
+  std::size_t dropped_records() const{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return dropped_records_;
+  }
+
+private:
+  struct task{
+    std::uint32_t conv;
+    std::string text;       // 记录任务是消息本身，搜索任务是关键词
+    viewer who;
+    std::size_t limit;
+    search_callback done;   // 为空表示记录任务
+  };
+
+  void run(){
+    std::deque<task> batch;
+    for(;;){
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_.wait(lock,[this]{ return stop_||!queue_.empty(); });
+        if(stop_&&queue_.empty()) return;
+        // 一次取走整个队列，处理的时候不持有锁
+        batch.swap(queue_);
+        pending_records_=0;
+        pending_searches_=0;
+      }
+      for(task& t:batch){
+        if(t.done) t.done(index_.search(t.text,t.who,t.limit));
+        else index_.add(t.conv,t.text);
+      }
+      batch.clear();
+    }
+  }
+
+private:
+  history_index index_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<task> queue_;
+  std::size_t pending_records_=0;
+  std::size_t pending_searches_=0;
+  std::size_t dropped_records_=0;
+  bool stop_=false;
+  // 最后声明，保证线程启动时其他成员都已经构造好了
+  std::thread worker_;
+};
+
+} // namespace chat
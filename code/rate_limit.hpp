@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "types.hpp"
+
+// 令牌桶限流：每个用户、每个房间、每个来源IP各一个桶，每个桶只有两个字段，检查和扣除都是O(1)。
+// 用户桶按客户名计算，断线重连或者从多个连接登录同一个名字都共用一个桶；登录之前按连接计算。
+// 时间由调用方传入，所以在sim.hpp里用假时钟驱动时结果是确定的
+namespace chat{
+
+// 每秒补充rate个令牌，最多攒burst个；rate为0表示不限速
+struct bucket_config{
+  double rate=0;
+  double burst=0;
+};
+
+struct rate_config{
+  bucket_config user{20,40};
+  bucket_config room{200,400};
+  bucket_config source{50,100};
+
+  static rate_config unlimited(){
+    return rate_config{{0,0},{0,0},{0,0}};
+  }
+};
+
+class token_bucket{
+public:
+  explicit token_bucket(double burst=0)
+    :tokens_(burst){
+  }
+
+  // 按距离上次补充经过的时间补充令牌，返回还差多久才能攒够一个令牌，够了返回0
+  clock_type::duration refill(const bucket_config& config,time_point now){
+    if(config.rate<=0) return clock_type::duration::zero();
+    if(now>last_){
+      tokens_=std::min(config.burst,tokens_+std::chrono::duration<double>(now-last_).count()*config.rate);
+      last_=now;
+    }
+    if(tokens_>=1) return clock_type::duration::zero();
+    return std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>((1-tokens_)/config.rate))+clock_type::duration(1);
+  }
+
+  void take(const bucket_config& config){
+    if(config.rate>0) tokens_-=1;
+  }
+
+private:
+  double tokens_;
+  time_point last_{};
+};
+
+class rate_limiter{
+public:
+  explicit rate_limiter(rate_config config)
+    :config_(config){
+    rooms_.fill(token_bucket(config_.room.burst));
+    names_.fill(token_bucket(config_.user.burst));
+  }
+
+  // source是来源地址的编号，同一个IP的所有连接共用一个桶
+  void open(session_id id,std::uint64_t source){
+    if(users_.size()<=id){
+      users_.resize(id+1);
+      sources_of_.resize(id+1,nullptr);
+      name_of_.resize(id+1,-1);
+    }
+    users_[id]=token_bucket(config_.user.burst);
+    name_of_[id]=-1;
+    source_state& src=sources_.try_emplace(source,source_state{token_bucket(config_.source.burst),0,source}).first->second;
+    ++src.sessions;
+    sources_of_[id]=&src;
+  }
+
+  // 来源IP的最后一个连接断开时释放它的桶，这样表的大小只和在线的IP数有关
+  void close(session_id id){
+    source_state* src=sources_of_[id];
+    sources_of_[id]=nullptr;
+    if(src&&--src->sessions==0) sources_.erase(src->key);
+  }
+
+  // 会话登录（或者换了名字）之后，它的消息改为从这个名字的桶里扣令牌。名字的桶不随连接断开而重置
+  void login(session_id id,char name){
+    name_of_[id]=static_cast<unsigned char>(name);
+  }
+
+  // room为-1表示这条消息不涉及房间。
+  // 相关的桶都有令牌时各扣一个并返回0；否则一个都不扣，返回需要等待的时长
+  clock_type::duration admit(session_id id,int room,time_point now){
+    token_bucket& user=name_of_[id]>=0?names_[name_of_[id]]:users_[id];
+    token_bucket& source=sources_of_[id]->bucket;
+    clock_type::duration wait=std::max(user.refill(config_.user,now),source.refill(config_.source,now));
+    if(room>=0) wait=std::max(wait,rooms_[room].refill(config_.room,now));
+    if(wait>clock_type::duration::zero()) return wait;
+    user.take(config_.user);
+    source.take(config_.source);
+    if(room>=0) rooms_[room].take(config_.room);
+    return wait;
+  }
+
+  std::size_t source_count() const{
+    return sources_.size();
+  }
+
+  // 每个会话固定占用的字节数，来源IP的桶按IP计算，不在其中
+  static constexpr std::size_t session_bytes(){
+    return sizeof(token_bucket)+sizeof(source_state*)+sizeof(std::int16_t);
+  }
+
+private:
+  struct source_state{
+    token_bucket bucket;
+    std::size_t sessions;
+    std::uint64_t key;
+  };
+
+private:
+  rate_config config_;
+  std::vector<token_bucket> users_;        // 按会话编号索引，登录之前使用
+  std::vector<std::int16_t> name_of_;      // 会话登录的客户名，未登录为-1
+  std::array<token_bucket,256> names_;     // 按客户名索引
+  std::vector<source_state*> sources_of_;  // 会话对应的来源桶，unordered_map的元素地址不会因为扩容而改变
+  std::array<token_bucket,256> rooms_;
+  std::unordered_map<std::uint64_t,source_state> sources_;
+};
+
+} // namespace chat
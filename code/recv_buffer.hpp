@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include "types.hpp"
+
+// 接收缓冲：先用对象内部的小数组，一行聊天消息通常放得下，空闲和轻度使用的连接不需要任何堆内存。
+// 放不下时才在堆上按两倍增长，数据全部处理完以后释放堆内存，回到内部数组；只剩半行数据时用fit缩到刚好放下。
+// 读操作进行期间缓冲区不能移动，所以prepare和fit都只能在没有读操作的时候调用
+namespace chat{
+
+class recv_buffer{
+public:
+  static constexpr std::size_t inline_size=64;
+
+  recv_buffer()=default;
+  recv_buffer(const recv_buffer&)=delete;
+  recv_buffer& operator=(const recv_buffer&)=delete;
+
+  // 返回可写区域的起点，写入后调用commit。可写区域至少有min_free字节。
+  // 缓冲区为空且内部数组就够用时释放堆内存
+  char* prepare(std::size_t min_free){
+    if(begin_==end_){
+      begin_=end_=0;
+      if(min_free<=inline_size) shrink();
+    }
+    if(capacity()-end_<min_free){
+      compact();
+      if(capacity()-end_<min_free) grow(end_+min_free);
+    }
+    return base()+end_;
+  }
+
+  std::size_t free_space() const{
+    return capacity()-end_;
+  }
+
+  void commit(std::size_t n){
+    end_+=static_cast<std::uint32_t>(n);
+  }
+
+  std::string_view data() const{
+    return std::string_view(base()+begin_,end_-begin_);
+  }
+
+  std::size_t size() const{
+    return end_-begin_;
+  }
+
+  void consume(std::size_t n){
+    begin_+=static_cast<std::uint32_t>(n);
+  }
+
+  // 把堆上的缓冲缩到刚好放下未处理的数据，放得进内部数组就回到内部数组。
+  // 容量只比数据多一点时不动，免得连续收数据时反复分配
+  void fit(){
+    if(!heap_) return;
+    std::size_t n=size();
+    if(n<=inline_size){
+      std::memcpy(inline_,heap_.get()+begin_,n);
+      shrink();
+    }
+    else if(heap_capacity_>n+n/4){
+      std::unique_ptr<char[]> fitted(new char[n]);
+      std::memcpy(fitted.get(),heap_.get()+begin_,n);
+      heap_=std::move(fitted);
+      heap_capacity_=static_cast<std::uint32_t>(n);
+    }
+    else{
+      return;
+    }
+    begin_=0;
+    end_=static_cast<std::uint32_t>(n);
+  }
+
+  std::size_t heap_bytes() const{
+    return heap_?heap_capacity_+alloc_overhead:0;
+  }
+
+private:
+  char* base(){
+    return heap_?heap_.get():inline_;
+  }
+  const char* base() const{
+    return heap_?heap_.get():inline_;
+  }
+  std::size_t capacity() const{
+    return heap_?heap_capacity_:inline_size;
+  }
+
+  void shrink(){
+    heap_.reset();
+    heap_capacity_=0;
+  }
+
+  // 把未处理的数据挪到开头
+  void compact(){
+    if(begin_==0) return;
+    std::memmove(base(),base()+begin_,end_-begin_);
+    end_-=begin_;
+    begin_=0;
+  }
+
+  void grow(std::size_t need){
+    std::size_t cap=capacity()*2;
+    while(cap<need) cap*=2;
+    std::unique_ptr<char[]> bigger(new char[cap]);
+    std::memcpy(bigger.get(),base(),end_);
+    heap_=std::move(bigger);
+    heap_capacity_=static_cast<std::uint32_t>(cap);
+  }
+
+private:
+  std::unique_ptr<char[]> heap_;
+  std::uint32_t heap_capacity_=0;
+  std::uint32_t begin_=0;
+  std::uint32_t end_=0;
+  char inline_[inline_size];
+};
+
+} // namespace chat
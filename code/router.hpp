@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rate_limit.hpp"
+#include "types.hpp"
+
+// 与传输层无关的路由核心：登录、点对点转发、房间广播、断开连接都在这里完成。
+// server.cpp里的tcp_connection只负责收发字节，bench.cpp则不经过socket，直接在进程内用假时钟驱动它。
+// 协议（每条消息以'\n'结尾，这里收到的line已经去掉了'\n'）：
+  // "L+客户名"         登录，把客户名和当前会话绑定
+  // "S+客户名+消息"     把整行转发给对应客户
+  // "J+房间名"         加入房间
+  // "R+房间名+消息"     把整行转发给房间里除自己以外的所有人
+  // "Q+关键词"         搜索自己参与过的私聊和所在房间的历史消息（由server交给chat::history_service处理）
+// 客户名和房间名都只允许有一个字符。
+// 任何命令在路由之前都要先通过rate_limiter，超速的消息不会被丢弃，而是返回throttled，由传输层稍后重新提交。
+// 每个会话积压的待发送数据不能超过max_outbox字节，一直不读的客户端超出后被标记为overflowed，由传输层断开
+namespace chat{
+
+// on_line的处理结果，由调用方决定要不要打印日志
+enum class route_result{
+  logged_in,
+  forwarded,
+  broadcast,
+  joined,
+  search,        // 搜索请求，router本身不处理
+  throttled,     // 超过限速，什么都没做，retry_after之后再提交同一行
+  unknown_user,  // 目标用户尚未登录
+  malformed      // 空行，或者缺少客户名/房间名
+};
+
+class router{
+public:
+  explicit router(rate_config limits=rate_config::unlimited(),std::size_t max_outbox=SIZE_MAX)
+    :max_outbox_(max_outbox),limiter_(limits){
+    users_.fill(invalid_session);
+  }
+
+  // 传输层每建立一条连接就申请一个会话，断开时归还，编号会被复用。
+  // source是来源IP的编号，用于按IP限速
+  session_id open_session(time_point now,std::uint64_t source=0){
+    session_id id;
+    if(!free_.empty()){
+      id=free_.back();
+      free_.pop_back();
+    }
+    else{
+      id=static_cast<session_id>(sessions_.size());
+      sessions_.emplace_back();
+    }
+    session& s=sessions_[id];
+    s.open=true;
+    s.named=false;
+    s.overflowed=false;
+    s.last_active=now;
+    limiter_.open(id,source);
+    ++open_count_;
+    return id;
+  }
+
+  void close_session(session_id id){
+    session& s=sessions_[id];
+    if(!s.open) return;
+    if(s.named&&users_[key(s.name)]==id) users_[key(s.name)]=invalid_session;
+    for(unsigned char room:s.rooms){
+      std::vector<session_id>& members=rooms_[room];
+      members.erase(std::find(members.begin(),members.end(),id));
+    }
+    s.rooms.clear();
+    s.outbox.clear();
+    s.open=false;
+    limiter_.close(id);
+    free_.push_back(id);
+    --open_count_;
+  }
+
+  // 处理会话from收到的一行消息。
+  // 每当某个会话的发送缓冲由空变为非空，就调用一次notify(目标会话)，传输层在其中调用take_output取走数据
+  template<class Notify>
+  route_result on_line(session_id from,std::string_view line,time_point now,Notify&& notify){
+    session& s=sessions_[from];
+    s.last_active=now;
+    // 先扣令牌再检查格式，空行和格式错误的消息同样受限速约束
+    s.retry_after=limiter_.admit(from,line.size()>=2&&line[0]=='R'?key(line[1]):-1,now);
+    if(s.retry_after>clock_type::duration::zero()) return route_result::throttled;
+    if(line.size()<2) return route_result::malformed;
+    switch(line[0]){
+    case 'L':{
+      if(s.named&&users_[key(s.name)]==from) users_[key(s.name)]=invalid_session;
+      s.name=line[1];
+      s.named=true;
+      users_[key(s.name)]=from;
+      limiter_.login(from,s.name);
+      return route_result::logged_in;
+    }
+    case 'J':{
+      unsigned char room=key(line[1]);
+      if(std::find(s.rooms.begin(),s.rooms.end(),room)==s.rooms.end()){
+        s.rooms.push_back(room);
+        rooms_[room].push_back(from);
+      }
+      return route_result::joined;
+    }
+    case 'Q':
+      return route_result::search;
+    case 'R':{
+      for(session_id to:rooms_[key(line[1])]){
+        if(to!=from) enqueue(to,line,notify);
+      }
+      return route_result::broadcast;
+    }
+    default:{
+      // 和原来的server一样，除了上面几种命令以外都当作点对点消息处理
+      session_id to=lookup(line[1]);
+      if(to==invalid_session) return route_result::unknown_user;
+      enqueue(to,line,notify);
+      return route_result::forwarded;
+    }
+    }
+  }
+
+  // 把会话id积压的待发送数据交换到out中（out原有内容会被丢弃），没有数据时返回false。
+  // 用swap而不是拷贝，这样两块缓冲的容量可以来回复用
+  bool take_output(session_id id,std::string& out){
+    std::string& outbox=sessions_[id].outbox;
+    if(outbox.empty()) return false;
+    out.clear();
+    out.swap(outbox);
+    return true;
+  }
+
+  // 直接给会话to发送一行，用于server自己产生的回复（比如搜索结果）
+  template<class Notify>
+  void send(session_id to,std::string_view line,Notify&& notify){
+    enqueue(to,line,notify);
+  }
+
+  // 积压的数据超过了max_outbox。之后发给它的消息都被丢弃，传输层应该尽快断开这个会话
+  bool overflowed(session_id id) const{
+    return sessions_[id].overflowed;
+  }
+
+  // 因为积压超限而被标记的会话数（累计）
+  std::size_t overflow_count() const{
+    return overflow_count_;
+  }
+
+  std::size_t max_outbox() const{
+    return max_outbox_;
+  }
+
+  // 会话空闲时，发送缓冲的容量超过limit就释放掉
+  void shrink_output(session_id id,std::size_t limit){
+    std::string& outbox=sessions_[id].outbox;
+    if(outbox.empty()&&outbox.capacity()>limit) std::string().swap(outbox);
+  }
+
+  session_id lookup(char name) const{
+    return users_[key(name)];
+  }
+
+  std::size_t session_count() const{
+    return open_count_;
+  }
+
+  time_point last_active(session_id id) const{
+    return sessions_[id].last_active;
+  }
+
+  // 上一次on_line返回throttled时需要等待的时长
+  clock_type::duration retry_after(session_id id) const{
+    return sessions_[id].retry_after;
+  }
+
+  // 每个会话固定占用的字节数（包括限速器中的部分）
+  static constexpr std::size_t session_bytes(){
+    return sizeof(session)+rate_limiter::session_bytes();
+  }
+
+  // 会话在堆上额外占用的字节数
+  std::size_t session_heap_bytes(session_id id) const{
+    const session& s=sessions_[id];
+    std::size_t bytes=string_heap_bytes(s.outbox);
+    if(s.rooms.capacity()) bytes+=s.rooms.capacity()+alloc_overhead;
+    return bytes;
+  }
+
+  std::size_t source_count() const{
+    return limiter_.source_count();
+  }
+
+  // 会话尚未登录时返回false
+  bool name_of(session_id id,char& name) const{
+    name=sessions_[id].name;
+    return sessions_[id].named;
+  }
+
+  const std::vector<unsigned char>& rooms_of(session_id id) const{
+    return sessions_[id].rooms;
+  }
+
+private:
+  struct session{
+    std::string outbox;               // 等待传输层取走的数据
+    std::vector<unsigned char> rooms; // 已加入的房间，断开时据此退出
+    time_point last_active{};
+    clock_type::duration retry_after{};
+    char name=0;
+    bool named=false;
+    bool open=false;
+    bool overflowed=false;            // 积压超过max_outbox_，等待传输层断开
+  };
+
+  static unsigned char key(char c){
+    return static_cast<unsigned char>(c);
+  }
+
+  // 超出上限时不再追加，只把会话标记为overflowed并通知一次，传输层在notify里发现后断开它
+  template<class Notify>
+  void enqueue(session_id to,std::string_view line,Notify& notify){
+    session& s=sessions_[to];
+    if(s.overflowed) return;
+    std::string& outbox=s.outbox;
+    if(outbox.size()+line.size()+1>max_outbox_){
+      s.overflowed=true;
+      ++overflow_count_;
+      notify(to);
+      return;
+    }
+    bool was_empty=outbox.empty();
+    outbox.append(line.data(),line.size());
+    outbox.push_back('\n');
+    if(was_empty) notify(to);
+  }
+
+private:
+  std::vector<session> sessions_;
+  std::vector<session_id> free_;
+  std::size_t open_count_=0;
+  std::size_t max_outbox_;
+  std::size_t overflow_count_=0;
+  std::array<session_id,256> users_;
+  std::array<std::vector<session_id>,256> rooms_;
+  rate_limiter limiter_;
+};
+
+} // namespace chat
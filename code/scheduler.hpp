@@ -0,0 +1,135 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "types.hpp"
+
+// 按会话公平地处理收到的消息：差额轮询(deficit round robin)。
+// 每一轮给就绪队列里的每个会话quantum字节的额度，会话只能处理额度以内的消息，用不完的额度留到下一轮，
+// 处理完一轮就把控制权还给io_context。这样一个塞满了流水线消息的连接每轮最多也只能处理quantum字节，
+// 只发一两条消息的用户最多等一轮就会被处理到。
+// 和router一样不依赖socket和系统时钟，sim.hpp和bench.cpp可以直接驱动它
+namespace chat{
+
+// 每个会话的服务时间统计
+struct service_stats{
+  clock_type::duration service_time{}; // 累计处理时间
+  clock_type::duration max_slice{};    // 单次轮到时处理时间的最大值
+  std::uint64_t messages=0;
+  std::uint64_t bytes=0;
+  std::uint64_t rounds=0;              // 被轮到的次数
+};
+
+class drr_scheduler{
+public:
+  explicit drr_scheduler(std::size_t quantum=4096)
+    :quantum_(quantum){
+  }
+
+  // 会话有待处理的消息时调用。返回true表示就绪队列由空变为非空，调用方需要安排新一轮调度
+  bool mark_ready(session_id id){
+    if(states_.size()<=id) states_.resize(id+1);
+    state& s=states_[id];
+    if(s.queued) return false;
+    s.queued=true;
+    bool was_empty=queue_.empty();
+    queue_.push_back(entry{id,s.epoch});
+    return was_empty;
+  }
+
+  // 会话关闭时调用。队列里残留的条目靠epoch识别，不需要从中间删除
+  void remove(session_id id){
+    if(states_.size()<=id) return;
+    state& s=states_[id];
+    ++s.epoch;
+    s.queued=false;
+    s.deficit=0;
+    s.stats=service_stats{};
+  }
+
+  // 执行一轮：本轮开始时在队列里的每个会话最多被轮到一次。
+  // peek(id)返回会话下一条消息的字节数，没有可处理的消息时返回0；
+  // serve(id)处理这条消息，返回false表示这条消息没有被处理（比如被限速）或会话已关闭，它会离开就绪队列直到再次mark_ready。
+  // 返回本轮结束后队列是否仍不为空
+  template<class Clock,class Peek,class Serve>
+  bool run_round(Clock&& now,Peek&& peek,Serve&& serve){
+    std::size_t n=queue_.size();
+    for(std::size_t i=0;i<n;i++){
+      entry e=queue_.front();
+      queue_.pop_front();
+      if(e.epoch!=states_[e.id].epoch||!states_[e.id].queued) continue;
+      states_[e.id].deficit+=quantum_;
+      time_point start=now();
+      bool runnable=true;
+      std::uint64_t messages=0,bytes=0;
+      for(;;){
+        std::size_t cost=peek(e.id);
+        if(cost==0){
+          runnable=false;
+          break;
+        }
+        if(cost>states_[e.id].deficit) break;
+        if(!serve(e.id)){
+          runnable=false;
+          break;
+        }
+        // 只有真正处理掉的消息才扣额度、计入统计，被限速的消息稍后重新提交时再算
+        states_[e.id].deficit-=cost;
+        ++messages;
+        bytes+=cost;
+      }
+      // serve里会话可能已经被关闭（remove），这时统计已经清零，不再记账
+      state& s=states_[e.id];
+      if(e.epoch!=s.epoch) continue;
+      clock_type::duration slice=now()-start;
+      s.stats.service_time+=slice;
+      if(slice>s.stats.max_slice) s.stats.max_slice=slice;
+      s.stats.messages+=messages;
+      s.stats.bytes+=bytes;
+      ++s.stats.rounds;
+      if(runnable){
+        queue_.push_back(e);
+      }
+      else{
+        // 离开队列时清空额度，空闲的会话不能攒额度
+        s.queued=false;
+        s.deficit=0;
+      }
+    }
+    return !queue_.empty();
+  }
+
+  const service_stats& stats(session_id id) const{
+    static const service_stats none{};
+    return id<states_.size()?states_[id].stats:none;
+  }
+
+  bool empty() const{
+    return queue_.empty();
+  }
+
+  // 每个会话固定占用的字节数
+  static constexpr std::size_t session_bytes(){
+    return sizeof(state);
+  }
+
+private:
+  struct state{
+    std::size_t deficit=0;
+    std::uint32_t epoch=0;
+    bool queued=false;
+    service_stats stats;
+  };
+  struct entry{
+    session_id id;
+    std::uint32_t epoch;
+  };
+
+private:
+  std::size_t quantum_;
+  std::vector<state> states_;
+  std::deque<entry> queue_;
+};
+
+} // namespace chat
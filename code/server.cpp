@@ -1,115 +1,433 @@
 #include <boost/asio.hpp>
 #include <iostream>
-#include <unordered_map>
+#include <vector>
 #include <memory>
 #include <array>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <charconv>
+#include "router.hpp"
+#include "history.hpp"
+#include "scheduler.hpp"
+#include "session_pool.hpp"
+#include "recv_buffer.hpp"
 
 using boost::asio::ip::tcp;
 
-// 管理socket，
-class tcp_connection
-  :public std::enable_shared_from_this<tcp_connection>
-{
-public:
-  using pointer=std::shared_ptr<tcp_connection>;
+// 默认的tcp::socket和steady_timer内部是类型擦除的any_io_executor，
+// 这里直接绑定io_context的执行器，每个连接能省下几十字节
+using executor_type=boost::asio::io_context::executor_type;
+using socket_type=boost::asio::basic_stream_socket<tcp,executor_type>;
+using acceptor_type=boost::asio::basic_socket_acceptor<tcp,executor_type>;
+using timer_type=boost::asio::basic_waitable_timer<std::chrono::steady_clock,boost::asio::wait_traits<std::chrono::steady_clock>,executor_type>;
+
+class tcp_connection;
+
+// 所有连接共享的状态：转发核心、连接池、聊天记录和调度器
+struct server_state{
+  server_state(boost::asio::io_context& io_context,chat::history_config history_config)
+    :io_context(io_context),router(chat::rate_config{},max_outbox_bytes),history(history_config){
+  }
+
+  // 每个会话在router里积压的待发送数据上限，客户端一直不读、超过这个量就断开它
+  static constexpr std::size_t max_outbox_bytes=256*1024;
 
-  static pointer create(boost::asio::io_context& io_context,std::unordered_map<char,pointer>& forward_table){
-    return pointer(new tcp_connection(io_context,forward_table));
+  // 按会话编号找到连接，会话已经关闭时返回nullptr
+  tcp_connection* connection(chat::session_id id){
+    return id<handles.size()?pool.get(handles[id]):nullptr;
   }
 
-  tcp_connection(boost::asio::io_context& io_context,std::unordered_map<char,pointer>& forward_table):
-    io_context_(io_context),socket_(io_context_),forward_table_(forward_table){
+  // 安排一轮调度。每轮结束后如果还有就绪的会话就再投递下一轮，两轮之间io_context可以处理其他读写事件
+  void wake();
+  void run_turn();
+
+  // 打印每个空闲连接和活跃连接平均占用的内存
+  void memory_report(std::ostream& os);
+
+  boost::asio::io_context& io_context;
+  chat::router router;
+  chat::session_pool<tcp_connection> pool;
+  // 按会话编号索引的连接句柄
+  std::vector<chat::pool_handle> handles;
+  chat::history_service history;
+  chat::drr_scheduler scheduler;
+  bool turn_posted=false;
+};
+
+// 管理socket，只负责收发字节，转发逻辑交给chat::router。
+// 连接对象放在server_state::pool里，异步回调只捕获句柄，回调执行时再凭句柄取回连接，连接已经销毁就直接返回。
+// 读到的数据留在buffer_里，由调度器按轮次调用serve_one逐行处理，处理完之前不再读socket
+class tcp_connection{
+public:
+  tcp_connection(server_state& state,socket_type socket):
+    state_(state),socket_(std::move(socket)),timer_(state.io_context){
 
     }
 
-  tcp::socket& socket(){
-    return socket_;
+  // 连接放进池中后向router申请会话，并登记句柄，router通过会话编号通知我们发送数据
+  void open(chat::pool_handle handle){
+    handle_=handle;
+    id_=state_.router.open_session(chat::clock_type::now(),source_key());
+    boost::system::error_code ignored;
+    socket_.non_blocking(true,ignored);
+    if(state_.handles.size()<=id_) state_.handles.resize(id_+1);
+    state_.handles[id_]=handle_;
+  }
+
+  // 取走router为本会话积压的数据并发送。同一时刻只允许有一个async_write，
+  // 写的过程中新到的数据继续积压在router里，写完再取
+  void flush(){
+    if(id_==chat::invalid_session) return;
+    if(state_.router.overflowed(id_)){
+      // flush可能是router在遍历房间成员时通过notify调用的，这时不能改动会话表，断开要投递到之后执行
+      std::cerr<<"发送积压超过"<<state_.router.max_outbox()<<"字节，断开连接"<<std::endl;
+      boost::asio::post(state_.io_context,[&state=state_,handle=handle_]{
+        tcp_connection* self=state.pool.get(handle);
+        if(self&&self->id_!=chat::invalid_session) self->close();
+      });
+      return;
+    }
+    if(writing_) return;
+    if(!state_.router.take_output(id_,write_buffer_)){
+      // 没有要发的数据了，把大块的发送缓冲还回去
+      if(write_buffer_.capacity()>max_idle_write_buffer) std::string().swap(write_buffer_);
+      state_.router.shrink_output(id_,max_idle_write_buffer);
+      return;
+    }
+    writing_=true;
+    boost::asio::async_write(socket_,boost::asio::buffer(write_buffer_),[&state=state_,handle=handle_](const boost::system::error_code& error,std::size_t bytes_transferred){
+      tcp_connection* self=state.pool.get(handle);
+      if(!self) return;
+      self->writing_=false;
+      if(!error) self->flush();
+    });
   }
 
-  // async_accept的回调函数需要调用该函数，然后该连接就会自动地接受和发送消息到对应目标
+  // 连接建立后需要调用该函数，然后该连接就会自动地接受消息。
+  // buffer_里还有完整的行没处理、或者正在等待限速时不读socket，剩下的数据留在内核缓冲区里，由TCP流控拖慢对方。
+  // 不直接发起async_read_some，而是先等socket可读，可读以后再准备缓冲、用非阻塞的read_some读出来。
+  // 这样等待期间没有读操作占着缓冲区，只剩半行数据时可以把缓冲缩到刚好放下
   void start(){
-    // 收到信息：检查目的地，转发信息
-    boost::asio::async_read_until(socket_,buffer_,'\n',[self=shared_from_this()](const boost::system::error_code& error,
-    std::size_t bytes_transferred){
-      if(!error){
-        self->handler(bytes_transferred);
-      } 
-      else
-    {
-        // 【“失败”】
-        // 检查是哪种“失败”
-
-        if (error == boost::asio::error::eof) // 是这种！！！！！！！！
-        {
-            // “正常”失败：客户端主动挂断了
-            std::cout << "客户端已正常断开连接。" << std::endl;
-        }
-        else if (error == boost::asio::error::operation_aborted)
-        {
-            // “正常”失败：我们自己关闭了服务器
-            std::cout << "操作被我们自己取消 (服务器关闭中)。" << std::endl;
-        }
-        else if (error == boost::asio::error::connection_reset)
-        {
-            // “异常”失败：客户端崩溃了
-            std::cerr << "客户端连接被重置 (崩溃)。" << std::endl;
-        }
-        else
-        {
-            // “异常”失败：其他所有网络错误
-            std::cerr << "读取错误: " << error.message() << std::endl;
-        }
-
-        // 无论哪种“失败”，这个会话 (tcp_connection) 都应该结束了。
-        // 我们 *不* 再提交下一个读任务。
-        // 这个回调函数返回后，(如果用了 shared_ptr)
-        // 这个会话对象就会被自动销毁。
+    if(reading_||deferred_||eof_||id_==chat::invalid_session||has_line()) return;
+    if(buffer_.size()>=max_line_bytes){
+      std::cerr<<"消息过长，断开连接"<<std::endl;
+      close();
+      return;
     }
+    buffer_.fit();
+    if(buffer_.size()>0) watch_partial();
+    reading_=true;
+    socket_.async_wait(socket_type::wait_read,[&state=state_,handle=handle_](const boost::system::error_code& error){
+      tcp_connection* self=state.pool.get(handle);
+      if(!self||self->id_==chat::invalid_session) return;
+      self->reading_=false;
+      if(!error) self->read_ready();
+      else self->read_failed(error);
     });
   }
 
+  // 调度器询问下一条消息的字节数，没有可处理的消息时返回0
+  std::size_t next_cost() const{
+    if(deferred_) return 0;
+    std::string_view data=buffer_.data();
+    std::size_t end=data.find('\n');
+    return end==std::string_view::npos?0:end+1;
+  }
+
+  // 处理buffer_中的第一行，返回false表示本会话暂时不能继续
+  bool serve_one(){
+    std::string_view data=buffer_.data();
+    std::size_t end=data.find('\n');
+    if(!dispatch(data.substr(0,end))) return false;
+    buffer_.consume(end+1);
+    progress_=true;
+    if(!has_line()){
+      if(eof_){
+        close();
+        return false;
+      }
+      start();
+    }
+    return true;
+  }
+
+  // 没有未处理的数据、没有正在进行的写、也没有在等待限速
+  bool idle() const{
+    return buffer_.size()==0&&!writing_&&!deferred_;
+  }
+
+  // 本连接在堆上额外占用的字节数（不含连接对象本身）
+  std::size_t heap_bytes() const{
+    return buffer_.heap_bytes()+chat::string_heap_bytes(write_buffer_);
+  }
+
 private:
-  void handler(std::size_t bytes_transferred){
-    // 转发buffer_中的消息，然后再次递归地调用start函数
-    std::istream is(&buffer_);
-    std::string line;
-    std::getline(is,line);
-    if(line[0]=='L'){
-      forward_table_[line[1]]=shared_from_this();
+  void read_ready(){
+    char* data=buffer_.prepare(read_hint_);
+    std::size_t space=buffer_.free_space();
+    boost::system::error_code error;
+    std::size_t bytes_transferred=socket_.read_some(boost::asio::buffer(data,space),error);
+    if(error==boost::asio::error::would_block) start();
+    else if(!error) handler(bytes_transferred,space);
+    else read_failed(error);
+  }
+
+  void read_failed(const boost::system::error_code& error){
+    // 【“失败”】
+    // 检查是哪种“失败”
+
+    if (error == boost::asio::error::eof) // 是这种！！！！！！！！
+    {
+        // “正常”失败：客户端主动挂断了
+        std::cout << "客户端已正常断开连接。" << std::endl;
     }
-    else{
-      if(forward_table_.find(line[1])!=forward_table_.end()){
-        boost::asio::async_write(forward_table_.find(line[1])->second->socket(),boost::asio::buffer(line+'\n'),[this](const boost::system::error_code& error,std::size_t bytes_transferred){
-        });
-      }
-      else{
-        std::cerr<<"server尚未与用户"<<line[1]<<"建立连接"<<std::endl;
+    else if (error == boost::asio::error::operation_aborted)
+    {
+        // “正常”失败：我们自己关闭了服务器
+        std::cout << "操作被我们自己取消 (服务器关闭中)。" << std::endl;
+    }
+    else if (error == boost::asio::error::connection_reset)
+    {
+        // “异常”失败：客户端崩溃了
+        std::cerr << "客户端连接被重置 (崩溃)。" << std::endl;
+    }
+    else
+    {
+        // “异常”失败：其他所有网络错误
+        std::cerr << "读取错误: " << error.message() << std::endl;
+    }
+
+    // 无论哪种“失败”，这个会话 (tcp_connection) 都应该结束了。
+    // 我们 *不* 再提交下一个读任务。已经收到的完整消息还是要处理完，
+    // 之后再把会话还给router，并把自己从连接池中销毁。
+    eof_=true;
+    if(!has_line()&&!deferred_) close();
+  }
+
+  // buffer_里有半行数据时，限时等这一行的结尾。期间处理掉过完整的行就重新计时，
+  // 一直凑不成一行（比如发了一大段不带'\n'的数据就不动了）就断开，免得这段数据一直占着内存。
+  // 和限速共用timer_：等待限速时不会读socket，也就不会有半行数据在计时
+  void watch_partial(){
+    if(watching_) return;
+    watching_=true;
+    progress_=false;
+    timer_.expires_after(partial_line_timeout);
+    timer_.async_wait([&state=state_,handle=handle_](const boost::system::error_code& error){
+      tcp_connection* self=state.pool.get(handle);
+      if(!self||self->id_==chat::invalid_session) return;
+      self->watching_=false;
+      if(error||self->deferred_||self->buffer_.size()==0||self->has_line()) return;
+      if(self->progress_){
+        self->watch_partial();
+        return;
       }
+      std::cerr<<"等待消息结尾超时，断开连接"<<std::endl;
+      self->close();
+    });
+  }
+
+  void handler(std::size_t bytes_transferred,std::size_t space){
+    buffer_.commit(bytes_transferred);
+    // 一次读满了说明对方还有数据，下次准备更大的缓冲；否则回到内部数组大小
+    if(bytes_transferred==space) read_hint_=static_cast<std::uint16_t>(std::min<std::size_t>(read_hint_*2,read_chunk));
+    else read_hint_=chat::recv_buffer::inline_size;
+    // 有完整的行就交给调度器，否则继续读
+    if(has_line()) ready();
+    else this->start();
+  }
+
+  bool has_line() const{
+    std::string_view data=buffer_.data();
+    return std::memchr(data.data(),'\n',data.size())!=nullptr;
+  }
+
+  void ready(){
+    if(!deferred_&&has_line()&&state_.scheduler.mark_ready(id_)) state_.wake();
+  }
+
+  // 把一行交给router转发，被限速时返回false
+  bool dispatch(std::string_view line){
+    chat::route_result result=state_.router.on_line(id_,line,chat::clock_type::now(),[this](chat::session_id to){
+      state_.connection(to)->flush();
+    });
+    if(result==chat::route_result::throttled){
+      // 超速了：这一行先留在buffer_里，等令牌补充够了再重新交给调度器。在此期间不再读socket，
+      // 后面的数据留在内核缓冲区里，发得太快的客户端会被TCP流控自然地拖慢，而其他连接不受影响
+      deferred_=true;
+      timer_.expires_after(state_.router.retry_after(id_));
+      timer_.async_wait([&state=state_,handle=handle_](const boost::system::error_code& error){
+        tcp_connection* self=state.pool.get(handle);
+        if(error||!self||self->id_==chat::invalid_session) return;
+        self->deferred_=false;
+        if(self->has_line()) self->ready();
+        else if(self->eof_) self->close();
+        else self->start();
+      });
+      return false;
+    }
+    if(result==chat::route_result::forwarded){
+      // 尚未登录的用户发出的私聊不知道属于哪个会话，不记录
+      char name;
+      if(state_.router.name_of(id_,name)) state_.history.record(chat::direct_conversation(name,line[1]),std::string(line));
+    }
+    else if(result==chat::route_result::broadcast){
+      state_.history.record(chat::room_conversation(line[1]),std::string(line));
     }
-    this->start();
+    else if(result==chat::route_result::search){
+      search(std::string(line.substr(1)));
+    }
+    else if(result==chat::route_result::unknown_user){
+      std::cerr<<"server尚未与用户"<<line[1]<<"建立连接"<<std::endl;
+    }
+    else if(result==chat::route_result::malformed){
+      // 只打印第一条，其余的只计数，断开时汇总，免得刷屏的客户端把时间都耗在写日志上
+      if(malformed_++==0) std::cerr<<"收到格式错误的消息："<<line<<std::endl;
+    }
+    return true;
+  }
+
+  // 搜索在history_service的后台线程上完成，结果再投递回io_context，由本连接发回给客户端
+  void search(std::string query){
+    chat::viewer who;
+    who.named=state_.router.name_of(id_,who.name);
+    who.rooms=state_.router.rooms_of(id_);
+    bool queued=state_.history.search(std::move(query),std::move(who),max_search_results,[&state=state_,handle=handle_](std::vector<std::string> results){
+      boost::asio::post(state.io_context,[&state,handle,results=std::move(results)]{
+        tcp_connection* self=state.pool.get(handle);
+        if(self) self->reply(results);
+      });
+    });
+    // 后台线程积压的搜索太多时直接拒绝
+    if(!queued) state_.router.send(id_,"Q搜索繁忙，请稍后再试",[this](chat::session_id){ flush(); });
+  }
+
+  // 每条结果以'Q'开头发回，最后附一行汇总。搜索找够max_search_results条就停，所以汇总只说显示了几条
+  void reply(const std::vector<std::string>& results){
+    if(id_==chat::invalid_session) return;
+    auto notify=[this](chat::session_id to){ flush(); };
+    for(const std::string& line:results) state_.router.send(id_,"Q"+line,notify);
+    state_.router.send(id_,"Q显示最近"+std::to_string(results.size())+"条消息",notify);
+  }
+
+  // 把来源IP转成一个整数，作为按IP限速的键
+  std::uint64_t source_key(){
+    boost::system::error_code error;
+    boost::asio::ip::address address=socket_.remote_endpoint(error).address();
+    if(error) return 0;
+    if(address.is_v4()) return address.to_v4().to_uint();
+    return std::hash<std::string>()(address.to_string());
+  }
+
+  void close(){
+    const chat::service_stats& stats=state_.scheduler.stats(id_);
+    std::cout<<"会话共处理"<<stats.messages<<"条消息，累计耗时"
+      <<std::chrono::duration_cast<std::chrono::microseconds>(stats.service_time).count()<<"us，单轮最长"
+      <<std::chrono::duration_cast<std::chrono::microseconds>(stats.max_slice).count()<<"us"<<std::endl;
+    if(malformed_>1) std::cerr<<"该会话共收到"<<malformed_<<"条格式错误的消息"<<std::endl;
+    state_.router.close_session(id_);
+    state_.scheduler.remove(id_);
+    state_.handles[id_]=chat::pool_handle{};
+    // 会话编号会被复用，关闭后还未完成的回调不能再用它做任何事
+    id_=chat::invalid_session;
+    timer_.cancel();
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    // 此时可能还在本对象的成员函数里，销毁要投递到之后执行。销毁后槽位的代数加一，残留的回调凭旧句柄找不到它
+    boost::asio::post(state_.io_context,[&state=state_,handle=handle_]{
+      state.pool.destroy(handle);
+    });
   }
 
 private:
-  boost::asio::io_context& io_context_;
-  tcp::socket socket_;
-  boost::asio::streambuf buffer_{};
-  std::unordered_map<char,pointer>& forward_table_;
+  static constexpr std::size_t max_search_results=20;
+  static constexpr std::size_t read_chunk=4096;
+  static constexpr std::size_t max_line_bytes=64*1024;       // 超过这么长还没有'\n'就断开
+  static constexpr std::size_t max_idle_write_buffer=1024;   // 空闲时发送缓冲超过这个容量就释放
+  static constexpr std::chrono::seconds partial_line_timeout{30}; // 半行数据最多等这么久
+
+  server_state& state_;
+  socket_type socket_;
+  timer_type timer_; // 被限速时用来推迟处理，否则用来给半行数据计时
+  chat::recv_buffer buffer_;
+  std::string write_buffer_;
+  chat::pool_handle handle_;
+  chat::session_id id_=chat::invalid_session;
+  std::uint32_t malformed_=0;   // 收到的格式错误的行数
+  std::uint16_t read_hint_=chat::recv_buffer::inline_size; // 下次读之前至少准备这么多空间
+  bool writing_=false;
+  bool reading_=false;
+  bool deferred_=false; // 正在等待限速
+  bool eof_=false;      // 对方已经断开，处理完buffer_中的完整行就关闭
+  bool watching_=false; // 半行数据正在计时
+  bool progress_=false; // 计时期间处理过完整的行
 };
 
-// 
+void server_state::wake(){
+  if(turn_posted) return;
+  turn_posted=true;
+  boost::asio::post(io_context,[this]{ run_turn(); });
+}
+
+void server_state::run_turn(){
+  turn_posted=false;
+  bool more=scheduler.run_round([]{ return chat::clock_type::now(); },
+    [this](chat::session_id id)->std::size_t{
+      tcp_connection* c=connection(id);
+      return c?c->next_cost():0;
+    },
+    [this](chat::session_id id){
+      // serve_one关闭连接时对象会延后销毁，这里直接用裸指针是安全的
+      return connection(id)->serve_one();
+    });
+  if(more) wake();
+}
+
+void server_state::memory_report(std::ostream& os){
+  // 每个连接固定占用的部分：池中的槽位、router和调度器里的会话状态、句柄表中的一项，
+  // 以及asio的反应器为每个socket单独分配的descriptor_state（加上分配器自己的开销）
+  constexpr std::size_t reactor_bytes=sizeof(boost::asio::detail::reactor::descriptor_state)+chat::alloc_overhead;
+  std::size_t fixed=decltype(pool)::slot_bytes()+chat::router::session_bytes()+chat::drr_scheduler::session_bytes()+sizeof(chat::pool_handle)+reactor_bytes;
+  std::size_t idle=0,active=0,idle_heap=0,active_heap=0;
+  for(chat::session_id id=0;id<handles.size();id++){
+    tcp_connection* c=connection(id);
+    if(!c) continue;
+    std::size_t heap=c->heap_bytes()+router.session_heap_bytes(id);
+    if(c->idle()){
+      ++idle;
+      idle_heap+=heap;
+    }
+    else{
+      ++active;
+      active_heap+=heap;
+    }
+  }
+  std::size_t total=(idle+active)*fixed+idle_heap+active_heap;
+  os<<"连接数："<<idle+active<<"（空闲"<<idle<<"，活跃"<<active<<"），池容量"<<pool.capacity()<<std::endl;
+  os<<"每个连接固定占用"<<fixed<<"字节（槽位"<<decltype(pool)::slot_bytes()<<"，router "<<chat::router::session_bytes()
+    <<"，调度器"<<chat::drr_scheduler::session_bytes()<<"，句柄"<<sizeof(chat::pool_handle)<<"，asio反应器"<<reactor_bytes<<"）"<<std::endl;
+  if(idle) os<<"空闲连接平均"<<fixed+idle_heap/idle<<"字节"<<std::endl;
+  if(active) os<<"活跃连接平均"<<fixed+active_heap/active<<"字节"<<std::endl;
+  os<<"合计"<<total<<"字节，另有"<<router.source_count()<<"个来源IP的限速桶"<<std::endl;
+  os<<"每个会话最多积压"<<router.max_outbox()<<"字节待发送数据，累计"<<router.overflow_count()<<"个会话因超出而被断开"<<std::endl;
+}
+
+// 收到SIGUSR1时打印内存报告（kill -USR1 <pid>）
 class tcp_server{
 public:
-  tcp_server(boost::asio::io_context& io_context)
-    :io_context_(io_context),acceptor_(io_context,tcp::endpoint(tcp::v4(),8080)){
+  tcp_server(boost::asio::io_context& io_context,chat::history_config history_config)
+    :io_context_(io_context),acceptor_(io_context,tcp::endpoint(tcp::v4(),8080)),signals_(io_context,SIGUSR1),state_(io_context,history_config){
       start_accept();
+      wait_signal();
     }
 private:
   void start_accept(){
-    // 创立new_connection管理socket，通过async_accept来获取socket，最终将socket和对应用户名填入转发表中
-    tcp_connection::pointer new_connection=tcp_connection::create(io_context_,forward_table_);
-    acceptor_.async_accept(new_connection->socket(),
-    [=](const boost::system::error_code& error){
+    // 通过async_accept拿到socket后再在连接池中创建连接，最终由router在收到登录消息时将用户名和会话绑定
+    acceptor_.async_accept([this](const boost::system::error_code& error,socket_type socket){
       if(!error){
+        chat::pool_handle handle=state_.pool.create(state_,std::move(socket));
+        tcp_connection* new_connection=state_.pool.get(handle);
+        new_connection->open(handle);
         new_connection->start();
         // 让对应的socket启动并开始工作，然后继续接受之后的连接请求
         start_accept();
@@ -119,16 +437,37 @@ private:
       }
     });
   }
+
+  void wait_signal(){
+    signals_.async_wait([this](const boost::system::error_code& error,int signal_number){
+      if(error) return;
+      state_.memory_report(std::cout);
+      wait_signal();
+    });
+  }
 private:
   boost::asio::io_context& io_context_;
-  tcp::acceptor acceptor_;
-  std::unordered_map<char,tcp_connection::pointer> forward_table_;
+  acceptor_type acceptor_;
+  boost::asio::signal_set signals_;
+  server_state state_;
 };
 
-int main(){
+// 可选参数：聊天记录最多保留的消息条数和字节数
+// 解析一个正整数命令行参数，整个字符串都必须是数字
+static bool parse_size(const char* text,std::size_t& value){
+  const char* end=text+std::strlen(text);
+  auto [ptr,error]=std::from_chars(text,end,value);
+  return error==std::errc()&&ptr==end&&value>0;
+}
+
+int main(int argc,char* argv[]){
+  chat::history_config history_config;
+  if(argc>3||(argc>1&&!parse_size(argv[1],history_config.max_messages))||(argc>2&&!parse_size(argv[2],history_config.max_bytes))){
+    std::cerr<<"用法："<<argv[0]<<" [最多保留的消息条数] [最多占用的字节数]"<<std::endl;
+    return 1;
+  }
   boost::asio::io_context io_context;
-  tcp_server server(io_context);
+  tcp_server server(io_context,history_config);
   io_context.run();
   return 0;
 }
-
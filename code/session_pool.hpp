@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// 会话对象池：对象按块连续存放，块一旦分配就不再移动，所以正在进行的异步操作引用的成员地址始终有效。
+// 外部只持有句柄（槽位下标+代数），槽位被释放时代数加一，旧句柄get()得到nullptr，
+// 回调里用句柄代替shared_ptr，既不需要控制块，也不会访问到已经被复用的槽位
+namespace chat{
+
+struct pool_handle{
+  std::uint32_t index=UINT32_MAX;
+  std::uint32_t generation=0;
+};
+
+template<class T,std::size_t ChunkSize=1024>
+class session_pool{
+public:
+  template<class... Args>
+  pool_handle create(Args&&... args){
+    if(free_head_==npos) grow();
+    std::uint32_t index=free_head_;
+    slot& s=at(index);
+    free_head_=s.next_free;
+    s.value.emplace(std::forward<Args>(args)...);
+    ++live_;
+    return pool_handle{index,s.generation};
+  }
+
+  // 句柄过期（槽位已被释放或复用）时返回nullptr
+  T* get(pool_handle h){
+    if(h.index>=capacity()) return nullptr;
+    slot& s=at(h.index);
+    if(s.generation!=h.generation||!s.value) return nullptr;
+    return &*s.value;
+  }
+
+  // 不能在T自己的成员函数里调用，调用方需要先把销毁投递到之后执行
+  void destroy(pool_handle h){
+    if(!get(h)) return;
+    slot& s=at(h.index);
+    s.value.reset();
+    ++s.generation;
+    s.next_free=free_head_;
+    free_head_=h.index;
+    --live_;
+  }
+
+  std::size_t size() const{
+    return live_;
+  }
+
+  std::size_t capacity() const{
+    return chunks_.size()*ChunkSize;
+  }
+
+  // 每个槽位占用的字节数，不论是否在用
+  static constexpr std::size_t slot_bytes(){
+    return sizeof(slot);
+  }
+
+private:
+  static constexpr std::uint32_t npos=UINT32_MAX;
+
+  struct slot{
+    std::optional<T> value;
+    std::uint32_t generation=0;
+    std::uint32_t next_free=npos;
+  };
+
+  slot& at(std::uint32_t index){
+    return chunks_[index/ChunkSize][index%ChunkSize];
+  }
+
+  void grow(){
+    std::uint32_t base=static_cast<std::uint32_t>(capacity());
+    chunks_.push_back(std::make_unique<slot[]>(ChunkSize));
+    // 倒着串进空闲链表，这样先分配到的是下标小的槽位
+    for(std::size_t i=ChunkSize;i-->0;){
+      chunks_.back()[i].next_free=free_head_;
+      free_head_=base+static_cast<std::uint32_t>(i);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<slot[]>> chunks_;
+  std::uint32_t free_head_=npos;
+  std::size_t live_=0;
+};
+
+} // namespace chat
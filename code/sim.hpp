@@ -0,0 +1,128 @@
+#pragma once
+#include "router.hpp"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// 进程内的确定性仿真：不开socket、不读系统时钟，用固定种子的随机数和假时钟驱动chat::router，
+// 同样的种子每次跑出来的操作序列完全一样，便于复现性能回归
+namespace chat{
+
+// 假时钟：只有调用advance才会前进
+class fake_clock{
+public:
+  time_point now() const{
+    return now_;
+  }
+  void advance(clock_type::duration d){
+    now_+=d;
+  }
+private:
+  time_point now_{};
+};
+
+struct sim_stats{
+  std::uint64_t logins=0;
+  std::uint64_t messages=0;
+  std::uint64_t broadcasts=0;
+  std::uint64_t disconnects=0;
+  std::uint64_t unknown_user=0;
+  std::uint64_t throttled=0;
+  std::uint64_t delivered_bytes=0;
+};
+
+// 模拟若干客户端反复登录、私聊、在房间里发言、断开重连。
+// 默认不限速；传入limits时被限速的消息直接计入stats().throttled，不再重发
+class simulation{
+public:
+  simulation(std::size_t clients,std::size_t rooms,std::uint64_t seed=1,rate_config limits=rate_config::unlimited())
+    :rng_(seed),clients_(clients),rooms_(rooms),router_(limits){
+    // 客户名只有一个字符，所以在线人数最多256
+    if(clients_>256) clients_=256;
+    if(rooms_==0) rooms_=1;
+    if(rooms_>256) rooms_=256;
+    sessions_.assign(clients_,invalid_session);
+    for(std::size_t i=0;i<clients_;i++) connect(i);
+  }
+
+  // 执行n个随机操作，每个操作之后假时钟前进1微秒
+  void run(std::uint64_t n){
+    for(std::uint64_t i=0;i<n;i++){
+      step();
+      clock_.advance(std::chrono::microseconds(1));
+    }
+  }
+
+  const sim_stats& stats() const{
+    return stats_;
+  }
+  chat::router& router(){
+    return router_;
+  }
+  fake_clock& clock(){
+    return clock_;
+  }
+
+private:
+  void step(){
+    std::size_t who=rng_()%clients_;
+    unsigned op=rng_()%100;
+    if(op<2){
+      // 断开后立刻重连，重新登录并加入房间
+      router_.close_session(sessions_[who]);
+      ++stats_.disconnects;
+      connect(who);
+    }
+    else if(op<20){
+      line_.assign("R");
+      line_.push_back(static_cast<char>(rng_()%rooms_));
+      line_.append("hello room");
+      deliver(who);
+      ++stats_.broadcasts;
+    }
+    else{
+      line_.assign("S");
+      line_.push_back(static_cast<char>(rng_()%clients_));
+      line_.append("hello");
+      if(deliver(who)==route_result::unknown_user) ++stats_.unknown_user;
+      ++stats_.messages;
+    }
+  }
+
+  void connect(std::size_t who){
+    // 每8个客户端共用一个来源IP
+    session_id id=router_.open_session(clock_.now(),who/8);
+    sessions_[who]=id;
+    line_.assign("L");
+    line_.push_back(static_cast<char>(who));
+    deliver(who);
+    line_.assign("J");
+    line_.push_back(static_cast<char>(who%rooms_));
+    deliver(who);
+    ++stats_.logins;
+  }
+
+  // 收到通知就立刻取走数据，相当于一个写得无限快的socket
+  route_result deliver(std::size_t who){
+    route_result result=router_.on_line(sessions_[who],line_,clock_.now(),[this](session_id to){
+      router_.take_output(to,scratch_);
+      stats_.delivered_bytes+=scratch_.size();
+    });
+    if(result==route_result::throttled) ++stats_.throttled;
+    return result;
+  }
+
+private:
+  std::mt19937_64 rng_;
+  std::size_t clients_;
+  std::size_t rooms_;
+  fake_clock clock_;
+  chat::router router_;
+  std::vector<session_id> sessions_;
+  std::string line_;
+  std::string scratch_;
+  sim_stats stats_;
+};
+
+} // namespace chat
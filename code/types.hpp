@@ -0,0 +1,24 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// router、rate_limiter、drr_scheduler和history共用的基本类型，以及统计内存时共用的计量方法。
+// 时间一律由调用方传入，server.cpp用系统时钟，sim.hpp和bench.cpp用假时钟
+namespace chat{
+
+using clock_type=std::chrono::steady_clock;
+using time_point=clock_type::time_point;
+using session_id=std::uint32_t;
+
+constexpr session_id invalid_session=UINT32_MAX;
+
+// 每次堆分配除了申请的大小以外，分配器自己还要占用的字节数（glibc malloc的块头和对齐）
+constexpr std::size_t alloc_overhead=16;
+
+// std::string在堆上占用的字节数，短字符串存在对象内部时为0
+inline std::size_t string_heap_bytes(const std::string& s){
+  return s.capacity()>std::string().capacity()?s.capacity()+1+alloc_overhead:0;
+}
+
+} // namespace chat